@@ -0,0 +1,193 @@
+// Microbenchmarks for the CPU-side particle kernels in
+// particle_kernels.hh (what main.cc runs) and bench_kernels.hh
+// (reference kernels not yet used by main.cc). No SDL or OpenGL
+// involved, so the numbers reflect only our own code, not driver or
+// vsync noise.
+//
+// Usage: ./bench [max_particles]   (default 10000000)
+//
+// Peak memory is about 3 particle arrays of max_particles each,
+// roughly 850 MB at the default; pass a smaller count on small
+// machines.
+
+#include <chrono>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+#include <random>
+
+#include "glm/glm.hpp"
+#include "glm/gtc/matrix_transform.hpp"
+
+#include "bench_kernels.hh"
+#include "particle_kernels.hh"
+
+using glm::vec3;
+
+// Keep repeating a kernel until at least this much time has been
+// spent on it, and report the fastest single run.
+constexpr double min_bench_seconds = 0.25;
+constexpr int max_bench_iterations = 1000;
+
+// Defeats dead-code elimination of kernel results.
+static volatile float sink;
+
+static void consume(const std::vector<visual_particle>& vp_list)
+{
+    if (!vp_list.empty()) sink = vp_list[vp_list.size() / 2].x;
+}
+
+static void print_header()
+{
+    printf("%-12s %10s %12s %14s %12s\n",
+        "kernel", "particles", "best ms", "particles/s", "MB/s");
+}
+
+// bytes_per_particle is a one-pass traffic model: bytes read plus
+// bytes written per input particle if the kernel streams over its
+// data once. It turns the best time into MB/s. Pass 0 for kernels
+// that don't fit that model (e.g. sorting, which is O(n log n)) and
+// MB/s is printed as "-".
+template <typename Kernel>
+static void run_bench(
+    const char* name,
+    size_t particle_count,
+    double bytes_per_particle,
+    Kernel&& kernel)
+{
+    using clock = std::chrono::steady_clock;
+    double best = 1e30;
+    double total = 0;
+    int iterations = 0;
+
+    while (total < min_bench_seconds && iterations < max_bench_iterations) {
+        auto start = clock::now();
+        kernel();
+        std::chrono::duration<double> elapsed = clock::now() - start;
+        best = std::min(best, elapsed.count());
+        total += elapsed.count();
+        ++iterations;
+    }
+
+    double particles_per_s = particle_count / best;
+    printf("%-12s %10zu %12.3f %14.4g ",
+        name, particle_count, best * 1e3, particles_per_s);
+    if (bytes_per_particle > 0) {
+        printf("%12.1f\n", particles_per_s * bytes_per_particle * 1e-6);
+    } else {
+        printf("%12s\n", "-");
+    }
+    fflush(stdout);
+}
+
+static void random_particles(
+    std::vector<visual_particle>& vp_list,
+    size_t particle_count,
+    std::mt19937& rng)
+{
+    vp_list.clear();
+    vp_list.reserve(particle_count);
+    for (size_t i = 0; i < particle_count; ++i) {
+        add_random_particle(vp_list, rng);
+    }
+}
+
+static void bench_particle_count(size_t n)
+{
+    constexpr double vp_size = sizeof(visual_particle);
+
+    // Only input and output live for the whole run; each benchmark's
+    // extra arrays are scoped to it so peak memory stays at three
+    // particle arrays.
+    std::mt19937 rng;
+    std::vector<visual_particle> input, output;
+    random_particles(input, n, rng);
+
+    run_bench("spawn", n, vp_size, [&] {
+        random_particles(output, n, rng);
+        consume(output);
+    });
+
+    // The per-frame copy main() does into a recycled frame packet;
+    // output already has capacity from spawn, as a packet would.
+    run_bench("copy", n, 2 * vp_size, [&] {
+        copy_particles(input, output);
+        consume(output);
+    });
+
+    {
+        particle_soa soa;
+        soa.resize(n);
+        for (size_t i = 0; i < n; ++i) {
+            soa.x[i] = input[i].x;
+            soa.y[i] = input[i].y;
+            soa.z[i] = input[i].z;
+            soa.red[i] = input[i].red;
+            soa.green[i] = input[i].green;
+            soa.blue[i] = input[i].blue;
+            soa.radius[i] = input[i].radius;
+        }
+        run_bench("pack", n, 2 * vp_size, [&] {
+            pack_particles(soa, output);
+            consume(output);
+        });
+    }
+
+    // Same camera as handle_controls' default orbit view. It sees
+    // all of add_random_particle's [0, 4.3)^3 cube, so spread the
+    // cull input over +/-50 units to get a realistic mix of kept and
+    // rejected particles.
+    vec3 eye(0.0f, 5.68f, -24.35f);
+    {
+        glm::mat4 view = glm::lookAt(eye, vec3(0, 0, 0), vec3(0, 1, 0));
+        glm::mat4 projection = glm::perspective(1.0f, 1280.0f / 960.0f, 0.01f, 400.0f);
+        glm::mat4 view_projection = projection * view;
+        std::vector<visual_particle> spread = input;
+        std::uniform_real_distribution<float> coordinate(-50.0f, 50.0f);
+        for (visual_particle& p : spread) {
+            p.x = coordinate(rng);
+            p.y = coordinate(rng);
+            p.z = coordinate(rng);
+        }
+
+        // Every particle is read; only survivors are written.
+        cull_particles(spread, view_projection, output);
+        double survivor_fraction = double(output.size()) / n;
+        run_bench("cull", n, vp_size * (1 + survivor_fraction), [&] {
+            cull_particles(spread, view_projection, output);
+            consume(output);
+        });
+        printf("%-12s %10zu survivors (%.1f%%)\n",
+            "", output.size(), 100.0 * survivor_fraction);
+    }
+
+    {
+        std::vector<std::pair<float, uint32_t>> keys;
+        run_bench("sort", n, 0, [&] {
+            sort_particles_by_depth(input, eye, keys, output);
+            consume(output);
+        });
+    }
+
+    {
+        std::vector<visual_particle> next;
+        random_particles(next, n, rng);
+        run_bench("interpolate", n, 3 * vp_size, [&] {
+            interpolate_particles(input, next, 0.5f, output);
+            consume(output);
+        });
+    }
+}
+
+int main(int argc, char** argv)
+{
+    size_t max_particles = 10000000;
+    if (argc > 1) max_particles = strtoull(argv[1], nullptr, 10);
+
+    print_header();
+    for (size_t n = 1000; n <= max_particles; n *= 10) {
+        bench_particle_count(n);
+    }
+}
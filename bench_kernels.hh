@@ -0,0 +1,135 @@
+#ifndef BENCH_KERNELS_HH_
+#define BENCH_KERNELS_HH_
+
+// Reference kernels that only bench.cc uses. main.cc does not do any
+// of this yet; these give a baseline for packing, interpolation,
+// culling, and sorting. Move a kernel into particle_kernels.hh when it
+// gets wired into frame preparation.
+
+#include <algorithm>
+#include <stddef.h>
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+#include "glm/glm.hpp"
+
+#include "particle_kernels.hh"
+
+// Particle state stored one array per field, the way a simulation
+// step would want it. pack_particles turns this into the
+// visual_particle array that draw_particles uploads.
+struct particle_soa
+{
+    std::vector<float> x, y, z;
+    std::vector<float> red, green, blue;
+    std::vector<float> radius;
+
+    size_t size() const { return x.size(); }
+
+    void resize(size_t n) {
+        for (auto* v : { &x, &y, &z, &red, &green, &blue, &radius }) {
+            v->resize(n);
+        }
+    }
+};
+
+// Pack the SoA particle state into the interleaved (AoS) layout used
+// for the instance buffer. out is resized to match.
+inline void pack_particles(
+    const particle_soa& soa,
+    std::vector<visual_particle>& out)
+{
+    const size_t n = soa.size();
+    out.resize(n);
+    visual_particle* dst = out.data();
+    for (size_t i = 0; i < n; ++i) {
+        dst[i] = visual_particle {
+            soa.x[i], soa.y[i], soa.z[i],
+            soa.red[i], soa.green[i], soa.blue[i],
+            soa.radius[i] };
+    }
+}
+
+// Linearly interpolate between two simulation snapshots with the same
+// particle count; alpha = 0 gives previous, alpha = 1 gives next.
+inline void interpolate_particles(
+    const std::vector<visual_particle>& previous,
+    const std::vector<visual_particle>& next,
+    float alpha,
+    std::vector<visual_particle>& out)
+{
+    const size_t n = std::min(previous.size(), next.size());
+    out.resize(n);
+    const float beta = 1.0f - alpha;
+    for (size_t i = 0; i < n; ++i) {
+        const visual_particle& a = previous[i];
+        const visual_particle& b = next[i];
+        out[i] = visual_particle {
+            a.x*beta + b.x*alpha,
+            a.y*beta + b.y*alpha,
+            a.z*beta + b.z*alpha,
+            a.red*beta + b.red*alpha,
+            a.green*beta + b.green*alpha,
+            a.blue*beta + b.blue*alpha,
+            a.radius*beta + b.radius*alpha };
+    }
+}
+
+// Copy into out only those particles whose bounding sphere touches
+// the view frustum of the given projection * view matrix. The six
+// planes are pulled straight out of the matrix rows (Gribb/Hartmann).
+inline void cull_particles(
+    const std::vector<visual_particle>& in,
+    const glm::mat4& view_projection,
+    std::vector<visual_particle>& out)
+{
+    const glm::mat4 rows = glm::transpose(view_projection);
+    glm::vec4 planes[6] = {
+        rows[3] + rows[0], rows[3] - rows[0],
+        rows[3] + rows[1], rows[3] - rows[1],
+        rows[3] + rows[2], rows[3] - rows[2],
+    };
+    for (auto& plane : planes) {
+        plane /= glm::length(glm::vec3(plane));
+    }
+
+    out.clear();
+    out.reserve(in.size());
+    for (const visual_particle& p : in) {
+        bool visible = true;
+        for (const auto& plane : planes) {
+            float d = plane.x*p.x + plane.y*p.y + plane.z*p.z + plane.w;
+            visible &= (d >= -p.radius);
+        }
+        if (visible) out.push_back(p);
+    }
+}
+
+// Sort particles front-to-back by distance from the eye so the depth
+// test can reject hidden fragments early. Sorts (key, index) pairs
+// and gathers, rather than shuffling the 28-byte particles around
+// inside std::sort.
+inline void sort_particles_by_depth(
+    const std::vector<visual_particle>& in,
+    glm::vec3 eye,
+    std::vector<std::pair<float, uint32_t>>& keys,
+    std::vector<visual_particle>& out)
+{
+    const size_t n = in.size();
+    keys.resize(n);
+    for (size_t i = 0; i < n; ++i) {
+        float dx = in[i].x - eye.x;
+        float dy = in[i].y - eye.y;
+        float dz = in[i].z - eye.z;
+        keys[i] = { dx*dx + dy*dy + dz*dz, uint32_t(i) };
+    }
+    std::sort(keys.begin(), keys.end());
+
+    out.resize(n);
+    for (size_t i = 0; i < n; ++i) {
+        out[i] = in[keys[i].second];
+    }
+}
+
+#endif
@@ -1,8 +1,12 @@
 #include <assert.h>
+#include <atomic>
 #include <chrono>
+#include <condition_variable>
 #include <future>
 #include <limits>
 #include <math.h>
+#include <mutex>
+#include <thread>
 #include <utility>
 #include <vector>
 
@@ -25,6 +29,8 @@ using glm::ivec3;
 #include "SDL2/SDL.h"
 #include "SDL2/SDL_opengl.h"
 
+#include "particle_kernels.hh"
+
 static int screen_x = 1280;
 static int screen_y = 960;
 constexpr float fovy_radians = 1.0f;
@@ -40,26 +46,6 @@ static glm::mat4 view;
 static glm::mat4 projection;
 static vec3 eye;
 
-// Structure for holding the position, color, and radius of an
-// on-screen particle. These are produced by interpolating the state
-// between simulation steps.
-//
-// DO NOT add, remove, reorder, or otherwise mess with this
-// struct. This is/will be used to communicate between C++, C#, Unity,
-// and OpenGL and assumptions about the memory layout and size of
-// this class are all over the place in this code.
-struct visual_particle
-{
-    // Formerly struct particle_render_info
-    float x = 0;
-    float y = 0;
-    float z = 0;
-    float red = 0;
-    float green = 0;
-    float blue = 0;
-    float radius = 0.0f;
-};
-
 
 
 // *** Boring OpenGL utility functions. ***
@@ -342,7 +328,9 @@ static const GLushort particle_elements[particle_element_count] = {
 static void draw_particles(
     GL gl,
     const std::vector<visual_particle>& vp_list,
-    vec3 position_offset
+    vec3 position_offset,
+    const glm::mat4& view_matrix,
+    const glm::mat4& proj_matrix
 ) {
     const visual_particle* particle_ptr = vp_list.data();
     const auto particle_count = vp_list.size();
@@ -448,8 +436,8 @@ static void draw_particles(
     // and render.
     gl.UseProgram(program_id);
 
-    gl.UniformMatrix4fv(view_matrix_id, 1, 0, &view[0][0]);
-    gl.UniformMatrix4fv(proj_matrix_id, 1, 0, &projection[0][0]);
+    gl.UniformMatrix4fv(view_matrix_id, 1, 0, &view_matrix[0][0]);
+    gl.UniformMatrix4fv(proj_matrix_id, 1, 0, &proj_matrix[0][0]);
     gl.Uniform3fv(uniform_position_id, 1, &position_offset[0]);
 
     gl.BindVertexArray(vao);
@@ -484,20 +472,6 @@ static void update_window_title(float fps)
 
 /// *** Controls ***
 
-void add_random_particle(std::vector<visual_particle>& vp_list, std::mt19937& rng)
-{
-    float x = rng() * 1e-9;
-    float y = rng() * 1e-9;
-    float z = rng() * 1e-9;
-    float r = rng() * 2.5e-10;
-    float g = rng() * 2.5e-10;
-    float b = rng() * 2.5e-10;
-    float radius = 0.1f;
-
-    auto vp = visual_particle { x,y,z,r,g,b,radius };
-    vp_list.push_back(vp);
-}
-
 static bool handle_controls(
     float dt,
     std::vector<visual_particle>& vp_list,
@@ -626,57 +600,223 @@ static bool handle_controls(
     return no_quit;
 }
 
+// *** Render thread ***
+//
+// The main thread polls SDL events, moves the camera, and copies
+// everything needed to draw a frame into a frame_packet. A separate
+// render thread, which owns the OpenGL context, draws each packet and
+// swaps buffers. That way a swap blocked on vsync (or a stalled
+// driver) doesn't also stall input handling and particle preparation
+// for the next frame.
+//
+// Packets are preallocated and recycled through a free list, so the
+// particle vectors keep their capacity from frame to frame. After
+// submitting a packet, the main thread blocks until the render thread
+// has taken it, so the two threads run in lockstep: the render thread
+// draws and swaps frame N while the main thread polls input and
+// builds frame N+1. At any time there is at most one packet pending,
+// one being drawn, and one being filled, so acquire_free never has to
+// wait.
+struct frame_packet
+{
+    std::vector<visual_particle> particles;
+    glm::mat4 view_matrix;
+    glm::mat4 proj_matrix;
+    int screen_x = 0;
+    int screen_y = 0;
+    bool quit = false;
+
+    // Which version of the main thread's particle list is in
+    // particles; lets the main thread skip copying an unchanged list.
+    uint64_t particles_version = 0;
+};
+
+constexpr int frame_packet_count = 3;
+
+class frame_pipeline
+{
+    frame_packet packets[frame_packet_count];
+    std::vector<frame_packet*> free_packets;
+    frame_packet* ready_packet = nullptr;
+    std::mutex mutex;
+    std::condition_variable ready_cv;
+    std::condition_variable taken_cv;
+    std::atomic<int> presented_frames { 0 };
+
+  public:
+    frame_pipeline() {
+        for (auto& packet : packets) free_packets.push_back(&packet);
+    }
+
+    frame_pipeline(const frame_pipeline&) = delete;
+    frame_pipeline& operator=(const frame_pipeline&) = delete;
+
+    // Main thread: get a packet to fill in.
+    frame_packet* acquire_free() {
+        std::lock_guard<std::mutex> lock(mutex);
+        assert(!free_packets.empty());
+        frame_packet* packet = free_packets.back();
+        free_packets.pop_back();
+        return packet;
+    }
+
+    // Main thread: queue a filled-in packet for drawing.
+    void submit(frame_packet* packet) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            assert(ready_packet == nullptr);
+            ready_packet = packet;
+        }
+        ready_cv.notify_one();
+    }
+
+    // Main thread: wait for the render thread to take the submitted
+    // packet, i.e. to finish the frame before it. This paces the main
+    // loop to one packet (and one particle copy) per presented frame.
+    void wait_for_pickup() {
+        std::unique_lock<std::mutex> lock(mutex);
+        taken_cv.wait(lock, [this] { return ready_packet == nullptr; });
+    }
+
+    // Render thread: get the submitted packet.
+    frame_packet* acquire_ready() {
+        frame_packet* packet;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            ready_cv.wait(lock, [this] { return ready_packet != nullptr; });
+            packet = ready_packet;
+            ready_packet = nullptr;
+        }
+        taken_cv.notify_one();
+        return packet;
+    }
+
+    // Render thread: return a drawn packet for reuse.
+    void release(frame_packet* packet) {
+        std::lock_guard<std::mutex> lock(mutex);
+        free_packets.push_back(packet);
+    }
+
+    // Render thread: count a frame that made it to the screen.
+    void frame_presented() {
+        ++presented_frames;
+    }
+
+    // Main thread: frames presented since the last call.
+    int take_presented_frames() {
+        return presented_frames.exchange(0);
+    }
+};
+
+static void render_thread_main(GL gl, frame_pipeline* pipeline) {
+    if (SDL_GL_MakeCurrent(window, gl_context) != 0) {
+        panic("Could not bind OpenGL context to render thread", SDL_GetError());
+    }
+
+    gl.Enable(GL_CULL_FACE);
+    gl.Enable(GL_DEPTH_TEST);
+    gl.ClearColor(0.1f, 0.5f, 1.0f, 1);
+
+    while (true) {
+        frame_packet* packet = pipeline->acquire_ready();
+        if (packet->quit) {
+            pipeline->release(packet);
+            break;
+        }
+
+        gl.Viewport(0, 0, packet->screen_x, packet->screen_y);
+        gl.Clear(GL_COLOR_BUFFER_BIT);
+        gl.Clear(GL_DEPTH_BUFFER_BIT);
+        draw_particles(
+            gl,
+            packet->particles,
+            vec3(0,0,0),
+            packet->view_matrix,
+            packet->proj_matrix);
+
+        // BufferData already copied the instance data, so the packet
+        // can go back to the main thread before the (maybe blocking)
+        // swap.
+        pipeline->release(packet);
+
+        SDL_GL_SwapWindow(window);
+        pipeline->frame_presented();
+        PANIC_IF_GL_ERROR(gl);
+    }
+
+    SDL_GL_MakeCurrent(window, nullptr);
+}
+
 // *** Main loop ***
 
 int main(int, char** argv) {
     argv0 = argv[0];
 
+    // Loading the functions creates the window and OpenGL context on
+    // this thread; hand the context over to the render thread.
     OpenGL_Functions gl;
-    gl.Enable(GL_CULL_FACE);
-    gl.Enable(GL_DEPTH_TEST);
-    gl.ClearColor(0.1f, 0.5f, 1.0f, 1);
+    if (SDL_GL_MakeCurrent(window, nullptr) != 0) {
+        panic("Could not release OpenGL context from main thread", SDL_GetError());
+    }
+
+    frame_pipeline pipeline;
+    std::thread render_thread(render_thread_main, std::cref(gl), &pipeline);
 
     bool no_quit = true;
-    int frames = 0;
 
     int previous_fps_update_ticks = 0;
-    int previous_frame_ticks = 0;
     int current_ticks = 0;
 
     std::vector<visual_particle> visual_particles;
+    uint64_t particles_version = 1;
     std::mt19937 rng;
 
     while (no_quit) {
-        // Show FPS and update window title every now and then.
-        previous_frame_ticks = current_ticks;
+        // Show FPS and update window title every now and then. Frames
+        // are counted by the render thread as they are presented.
         current_ticks = SDL_GetTicks();
 
-        ++frames;
         int fps_delta_ms = current_ticks - previous_fps_update_ticks;
         int ms_per_fps_update = 200;
         if (fps_delta_ms >= ms_per_fps_update) {
+            int frames = pipeline.take_presented_frames();
             float fps = frames / (fps_delta_ms * 0.001f);
-            frames = 0;
             previous_fps_update_ticks = current_ticks;
             update_window_title(fps);
         }
 
-        // Update the camera and prepare the screen for drawing particles.
+        // Update the camera, then package up everything the render
+        // thread needs to draw this frame.
         static int64_t previous_control_handle_ticks = 0;
         int64_t current_control_handle_ticks = SDL_GetTicks();
         float dt = 0.001f * (current_control_handle_ticks
                             - previous_control_handle_ticks);
         previous_control_handle_ticks = current_control_handle_ticks;
+        auto old_particle_count = visual_particles.size();
         no_quit = handle_controls(dt, visual_particles, rng);
-        gl.Viewport(0, 0, screen_x, screen_y);
 
-        auto delta_ms = current_ticks - previous_frame_ticks;
-
-        gl.Clear(GL_COLOR_BUFFER_BIT);
-        gl.Clear(GL_DEPTH_BUFFER_BIT);
-        draw_particles(gl, visual_particles, vec3(0,0,0));
+        // Particles are only ever added (Z key), so a size change is
+        // the only way the list can differ from a packet's copy.
+        if (visual_particles.size() != old_particle_count) {
+            ++particles_version;
+        }
 
-        SDL_GL_SwapWindow(window);
-        PANIC_IF_GL_ERROR(gl);
+        frame_packet* packet = pipeline.acquire_free();
+        if (packet->particles_version != particles_version) {
+            copy_particles(visual_particles, packet->particles);
+            packet->particles_version = particles_version;
+        }
+        packet->view_matrix = view;
+        packet->proj_matrix = projection;
+        packet->screen_x = screen_x;
+        packet->screen_y = screen_y;
+        packet->quit = false;
+        pipeline.submit(packet);
+        pipeline.wait_for_pickup();
     }
+
+    frame_packet* packet = pipeline.acquire_free();
+    packet->quit = true;
+    pipeline.submit(packet);
+    render_thread.join();
 }
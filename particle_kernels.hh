@@ -0,0 +1,57 @@
+#ifndef PARTICLE_KERNELS_HH_
+#define PARTICLE_KERNELS_HH_
+
+// CPU-side particle kernels: everything that touches particle data
+// before it gets handed to OpenGL. Kept free of SDL and OpenGL so
+// that bench.cc can time these without opening a window.
+
+#include <random>
+#include <vector>
+
+// Structure for holding the position, color, and radius of an
+// on-screen particle. These are produced by interpolating the state
+// between simulation steps.
+//
+// DO NOT add, remove, reorder, or otherwise mess with this
+// struct. This is/will be used to communicate between C++, C#, Unity,
+// and OpenGL and assumptions about the memory layout and size of
+// this class are all over the place in this code.
+struct visual_particle
+{
+    // Formerly struct particle_render_info
+    float x = 0;
+    float y = 0;
+    float z = 0;
+    float red = 0;
+    float green = 0;
+    float blue = 0;
+    float radius = 0.0f;
+};
+
+inline void add_random_particle(
+    std::vector<visual_particle>& vp_list,
+    std::mt19937& rng)
+{
+    float x = rng() * 1e-9;
+    float y = rng() * 1e-9;
+    float z = rng() * 1e-9;
+    float r = rng() * 2.5e-10;
+    float g = rng() * 2.5e-10;
+    float b = rng() * 2.5e-10;
+    float radius = 0.1f;
+
+    auto vp = visual_particle { x,y,z,r,g,b,radius };
+    vp_list.push_back(vp);
+}
+
+// Copy the particle list into a frame packet's instance data. out
+// keeps its capacity between frames, so this is a plain memcpy-sized
+// copy once the packet has seen the largest particle count.
+inline void copy_particles(
+    const std::vector<visual_particle>& in,
+    std::vector<visual_particle>& out)
+{
+    out.assign(in.begin(), in.end());
+}
+
+#endif